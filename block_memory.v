@@ -248,8 +248,18 @@ module block_memory(
         );
 
 
+    // the block rams register their outputs, so select between them with the address from the
+    // previous cycle; port a holds its output while writing
+    reg [31:11] a_read_chunk = 0;
+    reg [31:11] b_read_chunk = 0;
+    always @(posedge clk) begin
+        if(a_write_enable == 0)
+            a_read_chunk <= a_ram_address[31:11];
+        b_read_chunk <= b_ram_address[31:11];
+    end
+
     always @* begin
-        case(a_ram_address[31:11])
+        case(a_read_chunk)
         0: a_read_output = a_read_output_0;
         1: a_read_output = a_read_output_1;
         2: a_read_output = a_read_output_2;
@@ -259,7 +269,7 @@ module block_memory(
     end
 
     always @* begin
-        case(b_ram_address[31:11])
+        case(b_read_chunk)
         0: b_read_output = b_read_output_0;
         1: b_read_output = b_read_output_1;
         2: b_read_output = b_read_output_2;
@@ -54,6 +54,7 @@ module cpu(
     wire [31:0] memory_interface_rw_data_out;
     wire memory_interface_rw_address_valid;
     wire memory_interface_rw_wait;
+    wire memory_interface_rw_read_data_next_cycle;
 
     cpu_memory_interface #(
         .ram_size(ram_size),
@@ -72,6 +73,7 @@ module cpu(
         .rw_data_out(memory_interface_rw_data_out),
         .rw_address_valid(memory_interface_rw_address_valid),
         .rw_wait(memory_interface_rw_wait),
+        .rw_read_data_next_cycle(memory_interface_rw_read_data_next_cycle),
         .tty_write(tty_write),
         .tty_write_data(tty_write_data),
         .tty_write_busy(tty_write_busy),
@@ -126,6 +128,18 @@ module cpu(
     wire [31:0] register_rs1 = (decoder_rs1 == 0) ? 0 : registers[decoder_rs1];
     wire [31:0] register_rs2 = (decoder_rs2 == 0) ? 0 : registers[decoder_rs2];
 
+    // ram loads complete without waiting: the loaded value is written to the register file in the
+    // next cycle, and an instruction that reads it in that cycle waits for it
+    reg load_pending = 0;
+    reg [4:0] load_pending_rd = 0;
+    reg [2:0] load_pending_funct3 = 0;
+    reg [1:0] load_pending_address_low_2 = 0;
+
+    wire load_use_stall = load_pending
+                          & (fetch_output_state == `fetch_output_state_valid)
+                          & ((decoder_rs1 == load_pending_rd)
+                             | ((decoder_rs2 == load_pending_rd) & decoder_opcode[5] & ~decoder_opcode[2])); // op, store, branch and system
+
     wire [31:0] load_store_address = decoder_immediate + register_rs1;
 
     wire [1:0] load_store_address_low_2 = decoder_immediate[1:0] + register_rs1[1:0];
@@ -163,22 +177,30 @@ module cpu(
     assign memory_interface_rw_data_in[15:8] = load_store_address_low_2[0] ? register_rs2[7:0] : register_rs2[15:8];
     assign memory_interface_rw_data_in[7:0] = register_rs2[7:0];
 
-    wire [31:0] unmasked_loaded_value;
-
-    assign unmasked_loaded_value[7:0] = load_store_address_low_2[1]
-                                        ? (load_store_address_low_2[0] ? memory_interface_rw_data_out[31:24] : memory_interface_rw_data_out[23:16])
-                                        : (load_store_address_low_2[0] ? memory_interface_rw_data_out[15:8] : memory_interface_rw_data_out[7:0]);
-    assign unmasked_loaded_value[15:8] = load_store_address_low_2[1] ? memory_interface_rw_data_out[31:24] : memory_interface_rw_data_out[15:8];
-    assign unmasked_loaded_value[31:16] = memory_interface_rw_data_out[31:16];
-
-    wire [31:0] loaded_value;
+    function [31:0] get_loaded_value(
+        input [31:0] data,
+        input [2:0] funct3,
+        input [1:0] load_store_address_low_2
+        );
+        reg [31:0] unmasked_loaded_value;
+    begin
+        unmasked_loaded_value[7:0] = load_store_address_low_2[1]
+                                     ? (load_store_address_low_2[0] ? data[31:24] : data[23:16])
+                                     : (load_store_address_low_2[0] ? data[15:8] : data[7:0]);
+        unmasked_loaded_value[15:8] = load_store_address_low_2[1] ? data[31:24] : data[15:8];
+        unmasked_loaded_value[31:16] = data[31:16];
+        get_loaded_value[7:0] = unmasked_loaded_value[7:0];
+        get_loaded_value[15:8] = funct3[1:0] == 0 ? ({8{~funct3[2] & unmasked_loaded_value[7]}}) : unmasked_loaded_value[15:8];
+        get_loaded_value[31:16] = funct3[1] == 0 ? ({16{~funct3[2] & (funct3[0] ? unmasked_loaded_value[15] : unmasked_loaded_value[7])}}) : unmasked_loaded_value[31:16];
+    end
+    endfunction
 
-    assign loaded_value[7:0] = unmasked_loaded_value[7:0];
-    assign loaded_value[15:8] = decoder_funct3[1:0] == 0 ? ({8{~decoder_funct3[2] & unmasked_loaded_value[7]}}) : unmasked_loaded_value[15:8];
-    assign loaded_value[31:16] = decoder_funct3[1] == 0 ? ({16{~decoder_funct3[2] & (decoder_funct3[0] ? unmasked_loaded_value[15] : unmasked_loaded_value[7])}}) : unmasked_loaded_value[31:16];
+    wire [31:0] loaded_value = get_loaded_value(memory_interface_rw_data_out, decoder_funct3, load_store_address_low_2);
+    wire [31:0] pending_loaded_value = get_loaded_value(memory_interface_rw_data_out, load_pending_funct3, load_pending_address_low_2);
 
     assign memory_interface_rw_active = ~reset
                                         & (fetch_output_state == `fetch_output_state_valid)
+                                        & ~load_use_stall
                                         & ~load_store_misaligned
                                         & ((decode_action & (`decode_action_load | `decode_action_store)) != 0);
 
@@ -423,6 +445,7 @@ module cpu(
     function `fetch_action get_fetch_action(
         input `fetch_output_state fetch_output_state,
         input `decode_action decode_action,
+        input load_use_stall,
         input load_store_misaligned,
         input memory_interface_rw_address_valid,
         input memory_interface_rw_wait,
@@ -437,7 +460,10 @@ module cpu(
         `fetch_output_state_trap:
             get_fetch_action = `fetch_action_ack_trap;
         `fetch_output_state_valid: begin
-            if((decode_action & `decode_action_trap_illegal_instruction) != 0) begin
+            if(load_use_stall) begin
+                get_fetch_action = `fetch_action_wait;
+            end
+            else if((decode_action & `decode_action_trap_illegal_instruction) != 0) begin
                 get_fetch_action = `fetch_action_error_trap;
             end
             else if((decode_action & `decode_action_trap_ecall_ebreak) != 0) begin
@@ -498,6 +524,7 @@ module cpu(
     assign fetch_action = get_fetch_action(
         fetch_output_state,
         decode_action,
+        load_use_stall,
         load_store_misaligned,
         memory_interface_rw_address_valid,
         memory_interface_rw_wait,
@@ -612,15 +639,21 @@ module cpu(
     
     assign csr_op_is_valid = get_csr_op_is_valid(csr_number, csr_reads, csr_writes);
 
-    wire [63:0] cycle_counter = 0; // TODO: implement cycle_counter
+    reg [63:0] cycle_counter = 0;
+    always @(posedge clk or posedge reset) cycle_counter <= reset ? 0 : cycle_counter + 1;
     wire [63:0] time_counter = 0; // TODO: implement time_counter
     wire [63:0] instret_counter = 0; // TODO: implement instret_counter
 
     always @(posedge clk) begin:main_block
         if(reset) begin
             reset_to_initial();
+            load_pending <= 0;
             disable main_block;
         end
+        // written before the current instruction's result so that a later write to the same register wins
+        if(load_pending)
+            write_register(load_pending_rd, pending_loaded_value);
+        load_pending <= 0;
         case(fetch_output_state)
         `fetch_output_state_empty: begin
         end
@@ -628,12 +661,22 @@ module cpu(
             handle_trap();
         end
         `fetch_output_state_valid: begin:valid
-            if((fetch_action == `fetch_action_error_trap) | (fetch_action == `fetch_action_noerror_trap)) begin
+            if(load_use_stall) begin
+                // wait for the pending load
+            end
+            else if((fetch_action == `fetch_action_error_trap) | (fetch_action == `fetch_action_noerror_trap)) begin
                 handle_trap();
             end
             else if((decode_action & `decode_action_load) != 0) begin
-                if(~memory_interface_rw_wait)
+                if(memory_interface_rw_read_data_next_cycle) begin
+                    load_pending <= decoder_rd != 0;
+                    load_pending_rd <= decoder_rd;
+                    load_pending_funct3 <= decoder_funct3;
+                    load_pending_address_low_2 <= load_store_address_low_2;
+                end
+                else if(~memory_interface_rw_wait) begin
                     write_register(decoder_rd, loaded_value);
+                end
             end
             else if((decode_action & `decode_action_op_op_imm) != 0) begin
                 write_register(decoder_rd, alu_result);
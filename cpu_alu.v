@@ -32,15 +32,84 @@ module cpu_alu(
     output [31:0] result
     );
     
+    // opcode[5] is set for register-register operations; immediate operations keep their
+    // immediate in funct7 except for the shifts, rotates and the unary Zbb operations
     wire is_sub = funct7[5] & opcode[5];
     wire [31:0] add_sub_result = a + (is_sub ? ~b : b) + is_sub;
     wire [31:0] shift_left_result = a << b[4:0];
     wire [31:0] shift_right_result = funct7[5] ? $unsigned($signed(a) >>> b[4:0]) : a >> b[4:0];
-    wire [31:0] xor_result = a ^ b;
-    wire [31:0] or_result = a | b;
-    wire [31:0] and_result = a & b;
+    wire [63:0] rotate_left_wide = {a, a} << b[4:0];
+    wire [63:0] rotate_right_wide = {a, a} >> b[4:0];
+    wire [31:0] rotate_left_result = rotate_left_wide[63:32];
+    wire [31:0] rotate_right_result = rotate_right_wide[31:0];
+    // andn, orn and xnor
+    wire [31:0] logic_b = (opcode[5] & (funct7 == 7'h20)) ? ~b : b;
+    wire [31:0] xor_result = a ^ logic_b;
+    wire [31:0] or_result = a | logic_b;
+    wire [31:0] and_result = a & logic_b;
     wire [31:0] lt_arg_flip = {~funct3[0], 31'b0};
-    wire [31:0] lt_result = ((a ^ lt_arg_flip) < (b ^ lt_arg_flip)) ? 32'b1 : 32'b0;
+    wire a_lt_b = (a ^ lt_arg_flip) < (b ^ lt_arg_flip);
+    wire [31:0] lt_result = a_lt_b ? 32'b1 : 32'b0;
+    // min, minu, max and maxu use the same signed/unsigned selection as slt and sltu
+    wire is_min_max = opcode[5] & (funct7 == 7'h05);
+    wire [31:0] min_max_result = (a_lt_b ^ funct3[1]) ? a : b;
+    wire [31:0] zext_h_result = {16'b0, a[15:0]};
+    wire [31:0] orc_b_result = {{8{|a[31:24]}}, {8{|a[23:16]}}, {8{|a[15:8]}}, {8{|a[7:0]}}};
+    wire [31:0] rev8_result = {a[7:0], a[15:8], a[23:16], a[31:24]};
+    
+    function [31:0] count_leading_zeros(input [31:0] value);
+        integer i;
+        begin
+            count_leading_zeros = 32;
+            for(i = 0; i < 32; i = i + 1)
+                if(value[i])
+                    count_leading_zeros = 31 - i;
+        end
+    endfunction
+    
+    function [31:0] count_trailing_zeros(input [31:0] value);
+        integer i;
+        begin
+            count_trailing_zeros = 32;
+            for(i = 31; i >= 0; i = i - 1)
+                if(value[i])
+                    count_trailing_zeros = i;
+        end
+    endfunction
+    
+    function [31:0] count_ones(input [31:0] value);
+        integer i;
+        begin
+            count_ones = 0;
+            for(i = 0; i < 32; i = i + 1)
+                count_ones = count_ones + value[i];
+        end
+    endfunction
+    
+    // clz, ctz, cpop, sext.b and sext.h are selected by the rs2 field
+    function [31:0] unary_operation(input [4:0] select, input [31:0] value);
+        begin
+            case(select)
+            0: unary_operation = count_leading_zeros(value);
+            1: unary_operation = count_trailing_zeros(value);
+            2: unary_operation = count_ones(value);
+            4: unary_operation = {{24{value[7]}}, value[7:0]};
+            5: unary_operation = {{16{value[15]}}, value[15:0]};
+            default: unary_operation = 32'hXXXXXXXX;
+            endcase
+        end
+    endfunction
+    
+    wire [31:0] unary_result = unary_operation(b[4:0], a);
+    
+    wire [31:0] funct3_1_result = funct7[5] ? (opcode[5] ? rotate_left_result : unary_result) : shift_left_result;
+    wire [31:0] funct3_4_result = is_min_max ? min_max_result : ((opcode[5] & (funct7 == 7'h04)) ? zext_h_result : xor_result);
+    
+    wire [31:0] funct3_5_result = is_min_max ? min_max_result
+                                  : (funct7 == 7'h30) ? rotate_right_result
+                                  : (~opcode[5] & (funct7 == 7'h14)) ? orc_b_result
+                                  : (~opcode[5] & (funct7 == 7'h34)) ? rev8_result
+                                  : shift_right_result;
     
     function [31:0] mux8(
         input [2:0] select,
@@ -69,12 +138,12 @@ module cpu_alu(
     
     assign result = mux8(funct3,
                          add_sub_result,
-                         shift_left_result,
+                         funct3_1_result,
                          lt_result,
                          lt_result,
-                         xor_result,
-                         shift_right_result,
-                         or_result,
-                         and_result);
+                         funct3_4_result,
+                         funct3_5_result,
+                         is_min_max ? min_max_result : or_result,
+                         is_min_max ? min_max_result : and_result);
     
 endmodule
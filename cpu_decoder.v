@@ -142,16 +142,17 @@ module cpu_decoder(
                 calculate_action = `decode_action_trap_illegal_instruction;
             end
         end
-        `opcode_op_imm,
-        `opcode_op: begin
+        `opcode_op_imm: begin
+            // funct7 7'h30 is rori and the unary Zbb operations (clz, ctz, cpop, sext.b, sext.h)
+            // and 12'h287 and 12'h698 are orc.b and rev8
             if(funct3 == `funct3_slli) begin
-                if(funct7 == 0)
+                if(funct7 == 0 || (funct7 == 7'h30 && (rs2 == 0 || rs2 == 1 || rs2 == 2 || rs2 == 4 || rs2 == 5)))
                     calculate_action = `decode_action_op_op_imm;
                 else
                     calculate_action = `decode_action_trap_illegal_instruction;
             end
             else if(funct3 == `funct3_srli_srai) begin
-                if(funct7 == 0 || funct7 == 7'h20)
+                if(funct7 == 0 || funct7 == 7'h20 || funct7 == 7'h30 || immediate[11:0] == 12'h287 || immediate[11:0] == 12'h698)
                     calculate_action = `decode_action_op_op_imm;
                 else
                     calculate_action = `decode_action_trap_illegal_instruction;
@@ -160,6 +161,28 @@ module cpu_decoder(
                 calculate_action = `decode_action_op_op_imm;
             end
         end
+        `opcode_op: begin
+            // Zbb: funct7 7'h20 is also andn, orn and xnor, 7'h05 is min[u] and max[u],
+            // 7'h30 is rol and ror, and 7'h04 is zext.h
+            case(funct3)
+            `funct3_add_sub:
+                calculate_action = (funct7 == 0 || funct7 == 7'h20) ? `decode_action_op_op_imm : `decode_action_trap_illegal_instruction;
+            `funct3_sll:
+                calculate_action = (funct7 == 0 || funct7 == 7'h30) ? `decode_action_op_op_imm : `decode_action_trap_illegal_instruction;
+            `funct3_slt,
+            `funct3_sltu:
+                calculate_action = (funct7 == 0) ? `decode_action_op_op_imm : `decode_action_trap_illegal_instruction;
+            `funct3_xor:
+                calculate_action = (funct7 == 0 || funct7 == 7'h20 || funct7 == 7'h05 || (funct7 == 7'h04 && rs2 == 0)) ? `decode_action_op_op_imm : `decode_action_trap_illegal_instruction;
+            `funct3_srl_sra:
+                calculate_action = (funct7 == 0 || funct7 == 7'h20 || funct7 == 7'h30 || funct7 == 7'h05) ? `decode_action_op_op_imm : `decode_action_trap_illegal_instruction;
+            `funct3_or,
+            `funct3_and:
+                calculate_action = (funct7 == 0 || funct7 == 7'h20 || funct7 == 7'h05) ? `decode_action_op_op_imm : `decode_action_trap_illegal_instruction;
+            default:
+                calculate_action = `decode_action_trap_illegal_instruction;
+            endcase
+        end
         `opcode_lui,
         `opcode_auipc: begin
             calculate_action = `decode_action_lui_auipc;
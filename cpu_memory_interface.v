@@ -35,6 +35,7 @@ module cpu_memory_interface(
     output [31:0] rw_data_out,
     output rw_address_valid,
     output rw_wait,
+    output rw_read_data_next_cycle,
     output reg tty_write,
     output reg [7:0] tty_write_data,
     input tty_write_busy,
@@ -69,7 +70,9 @@ module cpu_memory_interface(
         );
     
     wire fetch_address_valid = (fetch_address >= ram_start / 4) & (fetch_address < (ram_start + ram_size) / 4);
-    wire rw_address_is_tty = (rw_address == tty_location / 4) & (rw_read_not_write | rw_byte_mask == 4'h1);
+    // sb, sh and sw to the tty queue 1, 2 or 4 characters, lowest address first
+    wire rw_address_is_tty = (rw_address == tty_location / 4)
+                             & (rw_read_not_write | rw_byte_mask == 4'h1 | rw_byte_mask == 4'h3 | rw_byte_mask == 4'hF);
     wire rw_address_is_gpio = rw_address == gpio_location / 4;
     wire rw_address_in_io_space = rw_address_is_tty | rw_address_is_gpio;
     wire rw_address_in_mem_space = (rw_address >= ram_start / 4) & (rw_address < (ram_start + ram_size) / 4);
@@ -81,11 +84,11 @@ module cpu_memory_interface(
 
     assign fetch_valid = ~reset & fetch_address_valid;
     
-    assign rw_wait = (rw_address_in_mem_space
-                     ? (rw_read_not_write 
-                        ? ~delay_done
-                        : 1'b0)
-                     : ~delay_done) | reset;
+    // ram accesses don't wait: the data for a ram read comes out of the block ram on rw_data_out in
+    // the following cycle, while the next access proceeds
+    assign rw_wait = (rw_address_in_mem_space ? 1'b0 : ~delay_done) | reset;
+    
+    assign rw_read_data_next_cycle = rw_address_in_mem_space & rw_read_not_write;
                      
     reg ignore_after_delay = 0;
     
@@ -102,6 +105,10 @@ module cpu_memory_interface(
     assign led_1 = ~gpio_output[0];
     assign led_3 = ~gpio_output[2];
     
+    // characters from the last tty store that haven't been written yet, next character in the low byte
+    reg [31:0] tty_queue_data = 0;
+    reg [2:0] tty_queue_count = 0;
+    
     always @(posedge clk or posedge reset) begin
         if(reset) begin
             delay_done <= 0;
@@ -110,22 +117,24 @@ module cpu_memory_interface(
             io_read_output_register <= 'hXXXXXXXX;
             last_read_was_ram <= 1'hX;
             gpio_output <= 0;
+            tty_queue_data <= 0;
+            tty_queue_count <= 0;
         end
         else begin
             delay_done <= 0;
             tty_write <= 0;
+            // tty_write_busy isn't valid until the cycle after tty_write
+            if(~tty_write & ~tty_write_busy & (tty_queue_count != 0)) begin
+                tty_write <= 1;
+                tty_write_data <= tty_queue_data[7:0];
+                tty_queue_data <= tty_queue_data >> 8;
+                tty_queue_count <= tty_queue_count - 1;
+            end
             if(ignore_after_delay) begin
                 ignore_after_delay <= 0;
             end
             else if(rw_active & rw_address_in_mem_space) begin
-                if(rw_read_not_write) begin
-                    delay_done <= 1;
-                    ignore_after_delay <= 1;
-                    last_read_was_ram <= 1;
-                end
-                else begin
-                    last_read_was_ram <= 1;
-                end
+                last_read_was_ram <= 1;
             end
             else if(rw_active & rw_address_in_io_space) begin
                 if(rw_address_is_tty) begin
@@ -136,12 +145,12 @@ module cpu_memory_interface(
                         ignore_after_delay <= 1;
                     end
                     else begin
-                        if(tty_write_busy) begin
+                        if(tty_queue_count != 0) begin
                             delay_done <= 0;
                         end
                         else begin
-                            tty_write <= 1;
-                            tty_write_data <= rw_data_in[7:0];
+                            tty_queue_data <= rw_data_in;
+                            tty_queue_count <= rw_byte_mask[3] ? 4 : rw_byte_mask[1] ? 2 : 1;
                             delay_done <= 1;
                             ignore_after_delay <= 1;
                         end
@@ -21,6 +21,7 @@
  *
  */
 `timescale 1ns / 100ps
+`include "cpu.vh"
 
 module main_test;
 
@@ -78,6 +79,106 @@ module main_test;
         g = vga_g;
         b = vga_b;
     end
+    
+    // PC-sampling profiler: run with +profile=<file> +cycles=<n>
+    // every cycle after reset is counted against the instruction at fetch_output_pc, split by
+    // fetch_action; cycles with no instruction are counted as bubbles of the last instruction.
+    // the counts are written to <file> as "<pc> <kind> <cycles>" lines when the simulation stops
+    // after <n> cycles; symbolize them with software/profile.sh
+    parameter profile_ram_start = 32'h1_0000;
+    parameter profile_ram_size = 'h8000;
+    parameter profile_kind_retire = 0;
+    parameter profile_kind_wait = 1;
+    parameter profile_kind_jump = 2;
+    parameter profile_kind_fence = 3;
+    parameter profile_kind_trap = 4;
+    parameter profile_kind_bubble = 5;
+    parameter profile_kind_count = 8;
+    parameter profile_counter_count = profile_ram_size / 4 * profile_kind_count;
+    
+    reg [8 * 256 - 1:0] profile_file_name;
+    reg profile_enabled;
+    integer profile_counters[0:profile_counter_count - 1];
+    reg [31:0] profile_last_pc = 32'hXXXXXXXX;
+    integer cycle_limit;
+    integer cycle_count = 0;
+    
+    integer profile_index;
+    integer profile_file;
+    
+    initial begin
+        profile_enabled = $value$plusargs("profile=%s", profile_file_name);
+        if(!$value$plusargs("cycles=%d", cycle_limit))
+            cycle_limit = 0;
+        for(profile_index = 0; profile_index < profile_counter_count; profile_index = profile_index + 1)
+            profile_counters[profile_index] = 0;
+    end
+    
+    function integer get_profile_kind(input `fetch_action fetch_action);
+    begin
+        case(fetch_action)
+        `fetch_action_wait:
+            get_profile_kind = profile_kind_wait;
+        `fetch_action_jump:
+            get_profile_kind = profile_kind_jump;
+        `fetch_action_fence:
+            get_profile_kind = profile_kind_fence;
+        `fetch_action_error_trap,
+        `fetch_action_noerror_trap,
+        `fetch_action_ack_trap:
+            get_profile_kind = profile_kind_trap;
+        default:
+            get_profile_kind = profile_kind_retire;
+        endcase
+    end
+    endfunction
+    
+    task profile_count(input [31:0] pc, input integer kind);
+    begin
+        if(pc - profile_ram_start < profile_ram_size) begin
+            profile_index = (pc - profile_ram_start) / 4 * profile_kind_count + kind;
+            profile_counters[profile_index] = profile_counters[profile_index] + 1;
+        end
+    end
+    endtask
+    
+    task write_profile;
+    begin
+        profile_file = $fopen(profile_file_name, "w");
+        for(profile_index = 0; profile_index < profile_counter_count; profile_index = profile_index + 1)
+            if(profile_counters[profile_index] != 0)
+                $fwrite(profile_file,
+                        "%h %0d %0d\n",
+                        profile_ram_start + profile_index / profile_kind_count * 4,
+                        profile_index % profile_kind_count,
+                        profile_counters[profile_index]);
+        $fclose(profile_file);
+    end
+    endtask
+    
+    // sample in the middle of the cycle so all the cpu's combinatorial signals have settled
+    always @(negedge clk) begin
+        if(~uut.reset) begin
+            cycle_count = cycle_count + 1;
+            if(profile_enabled) begin
+                case(uut.cpu1.fetch_output_state)
+                `fetch_output_state_valid: begin
+                    profile_last_pc = uut.cpu1.fetch_output_pc;
+                    profile_count(uut.cpu1.fetch_output_pc, get_profile_kind(uut.cpu1.fetch_action));
+                end
+                `fetch_output_state_trap:
+                    profile_count(profile_last_pc, profile_kind_trap);
+                default:
+                    profile_count(profile_last_pc, profile_kind_bubble);
+                endcase
+            end
+            if((cycle_limit != 0) & (cycle_count >= cycle_limit)) begin
+                if(profile_enabled)
+                    write_profile();
+                $finish;
+            end
+        end
+    end
       
 endmodule
 
@@ -42,6 +42,28 @@ inline void putchar(int ch)
 #endif
 }
 
+// the TTY also accepts halfword and word stores as 2 or 4 characters, first character in the
+// low byte
+inline void putchars2(std::uint16_t chars)
+{
+#ifdef EMULATE_TARGET
+    putchar(chars & 0xFF);
+    putchar(chars >> 8);
+#else
+    *reinterpret_cast<volatile std::uint16_t *>(0x80000000) = chars;
+#endif
+}
+
+inline void putchars4(std::uint32_t chars)
+{
+#ifdef EMULATE_TARGET
+    putchars2(chars & 0xFFFF);
+    putchars2(chars >> 16);
+#else
+    *reinterpret_cast<volatile std::uint32_t *>(0x80000000) = chars;
+#endif
+}
+
 inline void write_hex_digit(int value)
 {
     putchar("0123456789ABCDEF"[value]);
@@ -81,13 +103,40 @@ inline void write_gpio(std::uint32_t value)
 #endif
 }
 
+inline std::uint32_t read_cycle_counter()
+{
+#ifdef EMULATE_TARGET
+    return 0;
+#else
+    std::uint32_t retval;
+    // csrrs retval, cycle, x0; encoded with .insn because rdcycle needs Zicsr in -march since
+    // binutils 2.38 and GCC 12, and the cycle CSR number 0xC00 is -0x400 as a 12-bit immediate
+    asm volatile(".insn i 0x73, 2, %0, x0, -0x400" : "=r"(retval));
+    return retval;
+#endif
+}
+
 constexpr std::uint32_t switch_2_mask = 0x200;
 constexpr std::uint32_t switch_3_mask = 0x400;
 
 inline void puts(const char *str)
 {
-    while(*str)
-        putchar(*str++);
+    auto get = [&](std::size_t index) -> std::uint32_t
+    {
+        return static_cast<unsigned char>(str[index]);
+    };
+    while(get(0) && get(1) && get(2) && get(3))
+    {
+        putchars4(get(0) | get(1) << 8 | get(2) << 16 | get(3) << 24);
+        str += 4;
+    }
+    if(get(0) && get(1))
+    {
+        putchars2(get(0) | get(1) << 8);
+        str += 2;
+    }
+    if(get(0))
+        putchar(get(0));
 }
 
 constexpr std::size_t screen_x_size = 800 / 8;
@@ -149,6 +198,26 @@ constexpr T bidirectional_shift_right(T value, int amount) noexcept
     return bidirectional_shift_left(value, -amount);
 }
 
+// Zbb has count-leading-zeros as a single instruction; without it, __builtin_clz would pull in
+// libgcc's __clzsi2 and its lookup table
+#if defined(__riscv_zbb) || defined(EMULATE_TARGET)
+constexpr bool has_count_leading_zeros = true;
+#else
+constexpr bool has_count_leading_zeros = false;
+#endif
+
+constexpr int count_leading_zeros(std::uint32_t value) noexcept
+{
+    return value == 0 ? 32 : __builtin_clz(value);
+}
+
+// written as selects so they compile to min and max with Zbb
+template <typename T>
+constexpr T clamp(T value, T low, T high) noexcept
+{
+    return value < low ? low : (high < value ? high : value);
+}
+
 template <typename T = std::int32_t, std::size_t FractionalBits = 16>
 class Fixed
 {
@@ -330,11 +399,17 @@ public:
         v += one_half;
         return floori(v);
     }
+    friend constexpr Fixed min(Fixed a, Fixed b) noexcept
+    {
+        return a.value < b.value ? a : b;
+    }
+    friend constexpr Fixed max(Fixed a, Fixed b) noexcept
+    {
+        return a.value < b.value ? b : a;
+    }
     friend constexpr Fixed abs(Fixed v) noexcept
     {
-        if(v.value < 0)
-            return -v;
-        return v;
+        return max(v, -v);
     }
     friend constexpr Fixed sqrt(Fixed v) noexcept
     {
@@ -342,7 +417,17 @@ public:
             return 0;
         Fixed guess = 0;
         double_length_type guess_squared = 0;
-        for(int bit_index = (integer_bits + 1) / 2; bit_index >= -static_cast<int>(fractional_bits);
+        int start_bit_index = (integer_bits + 1) / 2;
+        if(has_count_leading_zeros && sizeof(T) <= sizeof(std::uint32_t))
+        {
+            // v < 2 ** value_bits, so the highest bit of the result is below 2 ** (value_bits / 2)
+            int value_bits = 32 - count_leading_zeros(static_cast<std::uint32_t>(v.value))
+                             - static_cast<int>(fractional_bits);
+            int highest_bit_index = ((value_bits + 1) >> 1) - 1;
+            if(highest_bit_index < start_bit_index)
+                start_bit_index = highest_bit_index;
+        }
+        for(int bit_index = start_bit_index; bit_index >= -static_cast<int>(fractional_bits);
             bit_index--)
         {
             Fixed new_guess = guess + make(static_cast<T>(1) << (bit_index + fractional_bits));
@@ -630,35 +715,208 @@ struct RayCaster
     }
 };
 
+constexpr std::size_t world_x_size = 16, world_z_size = 16;
+static const char world[world_x_size][world_z_size] = {
+// clang-format off
+    {'|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', 'X', 'X'},
+    {'|', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '|', ' ', ' ', ' ', 'X'},
+    {'|', ' ', '|', '|', '|', '|', '|', '|', '|', ' ', ' ', '|', ' ', ' ', ' ', 'X'},
+    {'|', ' ', ' ', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', '|', 'X', 'X'},
+    {'|', ' ', ' ', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', '|', '|', '|'},
+    {'|', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', ' ', '|'},
+    {'|', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', ' ', '|'},
+    {'|', ' ', '|', ' ', ' ', ' ', ' ', ' ', '|', ' ', ' ', '|', '|', '|', ' ', '|'},
+    {'|', ' ', '|', ' ', ' ', ' ', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', ' ', '|'},
+    {'|', ' ', '|', '|', '|', '|', '|', '|', '|', ' ', ' ', '|', ' ', ' ', ' ', '|'},
+    {'|', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '|', ' ', ' ', ' ', '|'},
+    {'|', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '|', ' ', ' ', ' ', '|'},
+    {'|', ' ', '|', '|', '|', '|', '|', '|', '|', ' ', ' ', '|', ' ', ' ', ' ', '|'},
+    {'|', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '|'},
+    {'|', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '|'},
+    {'|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|'},
+// clang-format on
+};
+
+static std::uint8_t start_col[screen_x_size] = {}, end_col[screen_x_size] = {};
+static char col_color[screen_x_size] = {};
+
+constexpr Fixed<> max_height = 10;
+
+// when true, only cast rays at the edges of wall faces and interpolate the columns in between
+constexpr bool use_wall_span_coherence = true;
+
+// when true, cast a ray for only every 2nd or 4th column if rendering the columns takes longer
+// than render_cycle_budget
+constexpr bool use_adaptive_resolution = true;
+constexpr std::uint32_t clock_frequency = 50'000'000;
+constexpr std::uint32_t render_cycle_budget = clock_frequency / 60;
+constexpr std::size_t max_ray_stride = 4;
+// used instead of the cycle counter when it doesn't count
+constexpr std::uint32_t estimated_cycles_per_ray = 4000;
+constexpr std::uint32_t estimated_cycles_per_ray_step = 40;
+
+struct ColumnHit
+{
+    Vec2D<std::int32_t> position;
+    char block;
+    int last_hit_dimension;
+    Fixed<> inverse_t;
+    constexpr bool is_same_face(const ColumnHit &rt) const noexcept
+    {
+        return position.x == rt.position.x && position.y == rt.position.y
+               && last_hit_dimension == rt.last_hit_dimension;
+    }
+};
+
+struct ColumnRenderer
+{
+    Vec2D<Fixed<>> view_position;
+    Fixed<> view_angle;
+    bool flash_on;
+    std::size_t ray_stride;
+    std::uint32_t ray_count = 0;
+    std::uint32_t ray_step_count = 0;
+    constexpr ColumnRenderer(Vec2D<Fixed<>> view_position,
+                             Fixed<> view_angle,
+                             bool flash_on,
+                             std::size_t ray_stride) noexcept
+        : view_position(view_position),
+          view_angle(view_angle),
+          flash_on(flash_on),
+          ray_stride(ray_stride)
+    {
+    }
+    ColumnHit cast(std::size_t x) noexcept
+    {
+        ray_count++;
+        Vec2D<Fixed<>> ray_direction(
+            (Fixed<>(x) + (0.5 - screen_x_size / 2.0)) * (2.0 / screen_x_size), 1);
+        ray_direction = rotate(ray_direction, view_angle);
+        RayCaster ray_caster(view_position, ray_direction);
+        auto hit_block = world[ray_caster.current_position.x][ray_caster.current_position.y];
+        while(hit_block == ' ')
+        {
+            ray_step_count++;
+            ray_caster.step();
+            hit_block = world[ray_caster.current_position.x][ray_caster.current_position.y];
+        }
+        ColumnHit retval;
+        retval.position = ray_caster.current_position;
+        retval.block = hit_block;
+        retval.last_hit_dimension = ray_caster.last_hit_dimension;
+        retval.inverse_t = ray_caster.current_t != Fixed<>::make(1) ? 1 / ray_caster.current_t :
+                                                                      max_height;
+        return retval;
+    }
+    void copy_column(std::size_t x, std::size_t source_x) const noexcept
+    {
+        start_col[x] = start_col[source_x];
+        end_col[x] = end_col[source_x];
+        col_color[x] = col_color[source_x];
+    }
+    void write(std::size_t x, const ColumnHit &hit) const noexcept
+    {
+        Fixed<> height = min(hit.inverse_t, max_height);
+        height *= screen_x_size / 2.0;
+        auto iheight = clamp<std::int32_t>(roundi(height), 0, screen_y_size);
+        start_col[x] = screen_y_size / 2 - iheight / 2;
+        end_col[x] = screen_y_size / 2 + (iheight + 1) / 2;
+        col_color[x] = 0xB0;
+        if(hit.block == 'X' && flash_on)
+        {
+            col_color[x] = '#';
+            if(hit.last_hit_dimension == 0)
+                col_color[x] = 'X';
+        }
+        else if(hit.last_hit_dimension == 0)
+        {
+            col_color[x] = 0xB1;
+        }
+    }
+    // fills the columns strictly between x0 and x1, whose hits have already been written.
+    // rays that hit the same face of the same block are interpolated: 1 / t is linear in x for a
+    // flat wall, so the interpolated heights match a cast ray to within rounding.
+    // spans no wider than ray_stride are filled by replicating the nearer end.
+    void render_span(std::size_t x0,
+                     const ColumnHit &hit0,
+                     std::size_t x1,
+                     const ColumnHit &hit1) noexcept
+    {
+        if(x1 - x0 <= 1)
+            return;
+        if(hit0.is_same_face(hit1))
+        {
+            // the step is computed once per span so that each column only adds; the accumulated
+            // rounding error is at most one ulp per column
+            auto step = Fixed<>::make((hit1.inverse_t - hit0.inverse_t).underlying_value()
+                                      / static_cast<std::int32_t>(x1 - x0));
+            auto hit = hit0;
+            for(std::size_t x = x0 + 1; x < x1; x++)
+            {
+                hit.inverse_t += step;
+                write(x, hit);
+            }
+            return;
+        }
+        if(x1 - x0 <= ray_stride)
+        {
+            for(std::size_t x = x0 + 1; x < x1; x++)
+                copy_column(x, x - x0 <= x1 - x ? x0 : x1);
+            return;
+        }
+        // keep the cast columns on multiples of ray_stride
+        auto x_middle = x0 + (x1 - x0) / 2 / ray_stride * ray_stride;
+        if(x_middle == x0)
+            x_middle += ray_stride;
+        auto hit_middle = cast(x_middle);
+        write(x_middle, hit_middle);
+        render_span(x0, hit0, x_middle, hit_middle);
+        render_span(x_middle, hit_middle, x1, hit1);
+    }
+    void render() noexcept
+    {
+        if(use_wall_span_coherence)
+        {
+            auto first_hit = cast(0);
+            write(0, first_hit);
+            auto last_hit = cast(screen_x_size - 1);
+            write(screen_x_size - 1, last_hit);
+            render_span(0, first_hit, screen_x_size - 1, last_hit);
+        }
+        else
+        {
+            for(std::size_t x = 0; x < screen_x_size; x += ray_stride)
+            {
+                write(x, cast(x));
+                for(std::size_t i = 1; i < ray_stride && x + i < screen_x_size; i++)
+                    copy_column(x + i, x);
+            }
+        }
+    }
+};
+
+// halving the stride at most doubles the render time, so only do that when it still fits
+inline std::size_t adapt_ray_stride(std::size_t ray_stride, std::uint32_t render_cycles)
+{
+    if(render_cycles > render_cycle_budget)
+    {
+        if(ray_stride < max_ray_stride)
+            ray_stride *= 2;
+    }
+    else if(ray_stride > 1 && render_cycles <= render_cycle_budget / 2)
+    {
+        ray_stride /= 2;
+    }
+    return ray_stride;
+}
+
 int main()
 {
-    static std::uint8_t start_col[screen_x_size] = {}, end_col[screen_x_size] = {};
-    static char col_color[screen_x_size] = {};
-    constexpr std::size_t world_x_size = 16, world_z_size = 16;
-    static const char world[world_x_size][world_z_size] = {
-    // clang-format off
-        {'|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', 'X', 'X'},
-        {'|', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '|', ' ', ' ', ' ', 'X'},
-        {'|', ' ', '|', '|', '|', '|', '|', '|', '|', ' ', ' ', '|', ' ', ' ', ' ', 'X'},
-        {'|', ' ', ' ', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', '|', 'X', 'X'},
-        {'|', ' ', ' ', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', '|', '|', '|'},
-        {'|', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', ' ', '|'},
-        {'|', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', ' ', '|'},
-        {'|', ' ', '|', ' ', ' ', ' ', ' ', ' ', '|', ' ', ' ', '|', '|', '|', ' ', '|'},
-        {'|', ' ', '|', ' ', ' ', ' ', ' ', ' ', '|', ' ', ' ', '|', ' ', ' ', ' ', '|'},
-        {'|', ' ', '|', '|', '|', '|', '|', '|', '|', ' ', ' ', '|', ' ', ' ', ' ', '|'},
-        {'|', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '|', ' ', ' ', ' ', '|'},
-        {'|', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '|', ' ', ' ', ' ', '|'},
-        {'|', ' ', '|', '|', '|', '|', '|', '|', '|', ' ', ' ', '|', ' ', ' ', ' ', '|'},
-        {'|', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '|'},
-        {'|', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', '|'},
-        {'|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|', '|'},
-    // clang-format on
-    };
     Vec2D<Fixed<>> view_position(1.5, 1.5);
     Fixed<> view_angle(0);
     std::uint32_t flash_counter = 0;
     constexpr std::uint32_t flash_period = 10;
+    std::size_t ray_stride = 1;
     while(true)
     {
         flash_counter++;
@@ -714,59 +972,34 @@ int main()
                 view_position = new_view_position;
 #endif
         }
-        for(std::size_t x = 0; x < screen_x_size; x++)
-        {
-            Vec2D<Fixed<>> ray_direction(
-                (Fixed<>(x) + (0.5 - screen_x_size / 2.0)) * (2.0 / screen_x_size), 1);
-            ray_direction = rotate(ray_direction, view_angle);
-            RayCaster ray_caster(view_position, ray_direction);
-            auto hit_block = world[ray_caster.current_position.x][ray_caster.current_position.y];
-            while(hit_block == ' ')
-            {
-                ray_caster.step();
-                hit_block = world[ray_caster.current_position.x][ray_caster.current_position.y];
-            }
-            constexpr Fixed<> max_height = 10;
-            Fixed<> height = ray_caster.current_t != Fixed<>::make(1) ?
-                                 1 / ray_caster.current_t :
-                                 max_height;
-            if(height > max_height)
-                height = max_height;
-            height *= screen_x_size / 2.0;
-            auto iheight = roundi(height);
-            if(iheight > static_cast<int>(screen_y_size))
-                iheight = screen_y_size;
-            else if(iheight < 0)
-                iheight = 0;
-            start_col[x] = screen_y_size / 2 - iheight / 2;
-            end_col[x] = screen_y_size / 2 + (iheight + 1) / 2;
-            col_color[x] = 0xB0;
-            if(hit_block == 'X' && flash_counter >= flash_period / 2)
-            {
-                col_color[x] = '#';
-                if(ray_caster.last_hit_dimension == 0)
-                    col_color[x] = 'X';
-            }
-            else if(ray_caster.last_hit_dimension == 0)
-            {
-                col_color[x] = 0xB1;
-            }
-        }
+        ColumnRenderer renderer(
+            view_position, view_angle, flash_counter >= flash_period / 2, ray_stride);
+        auto render_start_cycle = read_cycle_counter();
+        renderer.render();
+        std::uint32_t render_cycles = read_cycle_counter() - render_start_cycle;
+        if(render_cycles == 0)
+            render_cycles = renderer.ray_count * estimated_cycles_per_ray
+                            + renderer.ray_step_count * estimated_cycles_per_ray_step;
+        if(use_adaptive_resolution)
+            ray_stride = adapt_ray_stride(ray_stride, render_cycles);
         puts("\x1B[H");
+        auto get_screen_char = [](std::size_t x, std::size_t y) -> std::uint32_t
+        {
+            if(y >= end_col[x])
+                return 0xB2;
+            if(y >= start_col[x])
+                return static_cast<unsigned char>(col_color[x]);
+            return 0x20;
+        };
         for(std::size_t y = 0; y < screen_y_size; y++)
         {
-            for(std::size_t x = 0,
-                            x_end = (y == screen_y_size - 1 ? screen_x_size - 1 : screen_x_size);
-                x < x_end;
-                x++)
-            {
-                if(y >= end_col[x])
-                    putchar(0xB2);
-                else if(y >= start_col[x])
-                    putchar(col_color[x]);
-                else
-                    putchar(0x20);
-            }
+            std::size_t x = 0;
+            std::size_t x_end = (y == screen_y_size - 1 ? screen_x_size - 1 : screen_x_size);
+            for(; x + 4 <= x_end; x += 4)
+                putchars4(get_screen_char(x, y) | get_screen_char(x + 1, y) << 8
+                          | get_screen_char(x + 2, y) << 16 | get_screen_char(x + 3, y) << 24);
+            for(; x < x_end; x++)
+                putchar(get_screen_char(x, y));
         }
     }
 }
@@ -113,8 +113,18 @@ EOF
 
     cat <<EOF
 
+    // the block rams register their outputs, so select between them with the address from the
+    // previous cycle; port a holds its output while writing
+    reg [31:${block_size_log_2}] a_read_chunk = 0;
+    reg [31:${block_size_log_2}] b_read_chunk = 0;
+    always @(posedge clk) begin
+        if(a_write_enable == 0)
+            a_read_chunk <= a_ram_address[31:${block_size_log_2}];
+        b_read_chunk <= b_ram_address[31:${block_size_log_2}];
+    end
+
     always @* begin
-        case(a_ram_address[31:${block_size_log_2}])
+        case(a_read_chunk)
 EOF
 
     for((i = 0; i < chunk_count; i++)); do
@@ -129,7 +139,7 @@ EOF
     end
 
     always @* begin
-        case(b_ram_address[31:${block_size_log_2}])
+        case(b_read_chunk)
 EOF
 
     for((i = 0; i < chunk_count; i++)); do
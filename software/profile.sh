@@ -0,0 +1,125 @@
+#!/bin/bash
+# Copyright 2018 Jacob Lifshay
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# symbolizes the output of the PC-sampling profiler in main_test.v against ram.elf
+# writes collapsed stacks ("<function>;<kind> <cycles>", as accepted by flamegraph.pl) to stdout
+# and a per-function cycle and stall breakdown to stderr
+
+function error()
+{
+    echo "error:" "$@" >&2
+    exit 1
+}
+
+if (($# < 1 || $# > 2)); then
+    echo "usage: $0 <profile output> [<elf file>]" >&2
+    echo "example: $0 ../profile.txt ram.elf > profile.folded" >&2
+    exit 1
+fi
+
+profile_file="$1"
+elf_file="${2:-ram.elf}"
+[[ -f "$profile_file" ]] || error "can't find $profile_file"
+[[ -f "$elf_file" ]] || error "can't find $elf_file"
+
+symbols="$(riscv32-unknown-elf-nm -n -C --defined-only "$elf_file")" || error "can't read symbols from $elf_file"
+
+awk '
+function parse_hex(text,    i, retval)
+{
+    retval = 0
+    text = tolower(text)
+    for(i = 1; i <= length(text); i++)
+        retval = retval * 16 + index("0123456789abcdef", substr(text, i, 1)) - 1
+    return retval
+}
+
+function find_function(address,    low, high, middle)
+{
+    if(function_count == 0 || address < function_address[0])
+        return "[unknown]"
+    low = 0
+    high = function_count - 1
+    while(low < high)
+    {
+        middle = int((low + high + 1) / 2)
+        if(function_address[middle] <= address)
+            low = middle
+        else
+            high = middle - 1
+    }
+    return function_name[low]
+}
+
+BEGIN {
+    kind_name[0] = "retire"
+    kind_name[1] = "wait"
+    kind_name[2] = "jump"
+    kind_name[3] = "fence"
+    kind_name[4] = "trap"
+    kind_name[5] = "bubble"
+    function_count = 0
+}
+
+FNR == NR {
+    if($2 !~ /^[TtWw]$/)
+        next
+    name = $0
+    sub(/^[^ ]+ [^ ]+ /, "", name)
+    function_address[function_count] = parse_hex($1)
+    function_name[function_count] = name
+    function_count++
+    next
+}
+
+{
+    name = find_function(parse_hex($1))
+    kind = ($2 in kind_name) ? kind_name[$2] : "unknown"
+    stack_cycles[name ";" kind] += $3
+    function_cycles[name] += $3
+    function_kind_cycles[name, kind] += $3
+    total_cycles += $3
+}
+
+END {
+    for(stack in stack_cycles)
+        print stack " " stack_cycles[stack]
+    if(total_cycles == 0)
+        exit
+    sort_command = "sort -t \"\t\" -k2,2nr >&2"
+    printf("%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n", "function", "cycles", "%", "retire", "wait",
+           "jump", "trap", "fence", "bubble") > "/dev/stderr"
+    for(name in function_cycles)
+    {
+        printf("%s\t%d\t%.2f\t%d\t%d\t%d\t%d\t%d\t%d\n",
+               name,
+               function_cycles[name],
+               100 * function_cycles[name] / total_cycles,
+               function_kind_cycles[name, "retire"],
+               function_kind_cycles[name, "wait"],
+               function_kind_cycles[name, "jump"],
+               function_kind_cycles[name, "trap"],
+               function_kind_cycles[name, "fence"],
+               function_kind_cycles[name, "bubble"]) | sort_command
+    }
+    close(sort_command)
+}
+' <(echo "$symbols") "$profile_file"
@@ -0,0 +1,1342 @@
+/*
+ * Copyright 2018 Jacob Lifshay
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+// Fast functional simulator for the rv32 core: runs ram.elf on the host, predecoding the firmware
+// into basic blocks of instructions with resolved immediates and direct handler dispatch.
+// Instruction semantics (RV32I and Zbb) follow cpu.v, cpu_decoder.v and cpu_alu.v; the TTY and
+// GPIO registers follow cpu_memory_interface.v.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr std::uint32_t ram_start = 0x1'0000;
+constexpr std::uint32_t ram_size = 0x8000;
+constexpr std::uint32_t reset_vector = ram_start;
+constexpr std::uint32_t mtvec = ram_start + 0x40;
+constexpr std::uint32_t tty_location = 0x8000'0000;
+constexpr std::uint32_t gpio_location = 0x8000'0010;
+constexpr std::uint32_t switch_2_mask = 0x200;
+constexpr std::uint32_t switch_3_mask = 0x400;
+constexpr std::size_t max_block_length = 64;
+
+constexpr std::uint32_t cause_instruction_address_misaligned = 0x0;
+constexpr std::uint32_t cause_instruction_access_fault = 0x1;
+constexpr std::uint32_t cause_illegal_instruction = 0x2;
+constexpr std::uint32_t cause_breakpoint = 0x3;
+constexpr std::uint32_t cause_load_address_misaligned = 0x4;
+constexpr std::uint32_t cause_load_access_fault = 0x5;
+constexpr std::uint32_t cause_store_amo_address_misaligned = 0x6;
+constexpr std::uint32_t cause_store_amo_access_fault = 0x7;
+constexpr std::uint32_t cause_machine_environment_call = 0xB;
+
+constexpr std::uint32_t opcode_load = 0x03;
+constexpr std::uint32_t opcode_misc_mem = 0x0F;
+constexpr std::uint32_t opcode_op_imm = 0x13;
+constexpr std::uint32_t opcode_auipc = 0x17;
+constexpr std::uint32_t opcode_store = 0x23;
+constexpr std::uint32_t opcode_op = 0x33;
+constexpr std::uint32_t opcode_lui = 0x37;
+constexpr std::uint32_t opcode_branch = 0x63;
+constexpr std::uint32_t opcode_jalr = 0x67;
+constexpr std::uint32_t opcode_jal = 0x6F;
+constexpr std::uint32_t opcode_system = 0x73;
+
+constexpr std::uint32_t csr_cycle = 0xC00;
+constexpr std::uint32_t csr_time = 0xC01;
+constexpr std::uint32_t csr_instret = 0xC02;
+constexpr std::uint32_t csr_cycleh = 0xC80;
+constexpr std::uint32_t csr_timeh = 0xC81;
+constexpr std::uint32_t csr_instreth = 0xC82;
+constexpr std::uint32_t csr_mvendorid = 0xF11;
+constexpr std::uint32_t csr_marchid = 0xF12;
+constexpr std::uint32_t csr_mimpid = 0xF13;
+constexpr std::uint32_t csr_mhartid = 0xF14;
+constexpr std::uint32_t csr_mstatus = 0x300;
+constexpr std::uint32_t csr_misa = 0x301;
+constexpr std::uint32_t csr_mie = 0x304;
+constexpr std::uint32_t csr_mtvec = 0x305;
+constexpr std::uint32_t csr_mscratch = 0x340;
+constexpr std::uint32_t csr_mepc = 0x341;
+constexpr std::uint32_t csr_mcause = 0x342;
+constexpr std::uint32_t csr_mip = 0x344;
+
+constexpr std::uint32_t misa = 0x4000'0100; // RV32I (Zbb isn't reported in misa)
+
+// writes to x0 are redirected to this register so handlers never have to check for it
+constexpr std::uint8_t discard_register = 32;
+
+class Simulator;
+struct DecodedInstruction;
+
+// returns true to continue with the next instruction in the block, false when the handler has
+// changed pc (jumps, traps, or anything that requires going back to the dispatcher)
+typedef bool (*Handler)(Simulator &simulator, const DecodedInstruction &instruction);
+
+struct DecodedInstruction
+{
+    Handler handler;
+    std::uint32_t pc;
+    std::uint32_t immediate;
+    std::uint8_t rd;
+    std::uint8_t rs1;
+    std::uint8_t rs2;
+    std::uint8_t funct3;
+};
+
+struct Block
+{
+    std::uint32_t start_pc;
+    std::uint32_t end_pc;
+    // always ends with an instruction whose handler returns false
+    std::vector<DecodedInstruction> instructions;
+    bool ends_with_fallthrough;
+};
+
+struct InputScriptEntry
+{
+    std::uint64_t frame;
+    std::uint32_t switches;
+};
+
+class Simulator
+{
+public:
+    std::uint32_t registers[33] = {};
+    std::uint32_t pc = reset_vector;
+    std::uint32_t mcause = 0;
+    std::uint32_t mepc = 0;
+    std::uint32_t mscratch = 0;
+    bool mstatus_mie = false;
+    bool mstatus_mpie = false;
+    bool mie_meie = false;
+    bool mie_mtie = false;
+    bool mie_msie = false;
+    std::uint8_t gpio_output = 0;
+    std::uint32_t gpio_switches = 0;
+    bool running = true;
+    bool halted = false;
+    bool flush_pending = false;
+    std::uint64_t instruction_count = 0;
+    std::uint64_t frame_count = 0;
+    std::uint64_t frame_limit = 0;
+    std::uint64_t blocks_decoded = 0;
+    std::uint64_t cache_flushes = 0;
+    std::FILE *tty_output = stdout;
+    bool tty_utf8 = false;
+    std::vector<InputScriptEntry> input_script;
+    std::size_t input_script_position = 0;
+    // the instructions of the block being run, to count the instructions retired within it
+    const DecodedInstruction *current_block_instructions = nullptr;
+
+private:
+    std::vector<std::uint8_t> ram;
+    std::vector<bool> word_is_code;
+    std::vector<Block *> block_table;
+    std::vector<std::unique_ptr<Block>> blocks;
+
+public:
+    Simulator()
+        : ram(ram_size, 0), word_is_code(ram_size / 4, false), block_table(ram_size / 4, nullptr)
+    {
+    }
+    static bool is_ram_address(std::uint32_t address) noexcept
+    {
+        return address - ram_start < ram_size;
+    }
+    std::uint32_t read_ram_u32(std::uint32_t address) const noexcept
+    {
+        auto p = &ram[address - ram_start];
+        return static_cast<std::uint32_t>(p[0]) | static_cast<std::uint32_t>(p[1]) << 8
+               | static_cast<std::uint32_t>(p[2]) << 16 | static_cast<std::uint32_t>(p[3]) << 24;
+    }
+    void write_ram_byte(std::uint32_t address, std::uint8_t value) noexcept
+    {
+        ram[address - ram_start] = value;
+    }
+    bool load_elf(const std::string &file_name);
+    void run();
+    bool trap(std::uint32_t cause, std::uint32_t epc) noexcept
+    {
+        mstatus_mpie = mstatus_mie;
+        mstatus_mie = false;
+        mepc = epc;
+        mcause = cause;
+        pc = mtvec;
+        return false;
+    }
+    bool load_io(std::uint32_t address, std::uint32_t &word) noexcept;
+    bool store_io(std::uint32_t address, std::uint32_t byte_mask, std::uint32_t value) noexcept;
+    // called after a store to RAM; returns false when the store hit decoded code
+    bool check_code_store(std::uint32_t address) noexcept
+    {
+        if(!word_is_code[(address - ram_start) / 4])
+            return true;
+        flush_pending = true;
+        return false;
+    }
+    void flush_blocks() noexcept
+    {
+        cache_flushes++;
+        flush_pending = false;
+        blocks.clear();
+        std::fill(block_table.begin(), block_table.end(), nullptr);
+        std::fill(word_is_code.begin(), word_is_code.end(), false);
+    }
+    bool csr(const DecodedInstruction &instruction) noexcept;
+
+private:
+    void update_switches() noexcept
+    {
+        while(input_script_position < input_script.size()
+              && input_script[input_script_position].frame <= frame_count)
+            gpio_switches = input_script[input_script_position++].switches;
+    }
+    void write_tty(std::uint8_t ch);
+    Block *decode_block(std::uint32_t start_pc);
+};
+
+template <typename T>
+T sign_extend(std::uint32_t value, unsigned bits) noexcept
+{
+    auto shift = 32 - bits;
+    return static_cast<T>(static_cast<std::int32_t>(value << shift) >> shift);
+}
+
+bool handle_illegal_instruction(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    return simulator.trap(cause_illegal_instruction, instruction.pc);
+}
+
+bool handle_fallthrough(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    simulator.pc = instruction.pc;
+    return false;
+}
+
+bool handle_lui(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    simulator.registers[instruction.rd] = instruction.immediate;
+    return true;
+}
+
+bool handle_auipc(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    simulator.registers[instruction.rd] = instruction.pc + instruction.immediate;
+    return true;
+}
+
+bool handle_jal(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    auto target = instruction.pc + instruction.immediate;
+    if(target & 2)
+        return simulator.trap(cause_instruction_address_misaligned, instruction.pc);
+    if(target == instruction.pc)
+    {
+        // jump to self: the firmware has stopped (this is what .trap in startup.S does)
+        simulator.halted = true;
+        simulator.running = false;
+    }
+    simulator.registers[instruction.rd] = instruction.pc + 4;
+    simulator.pc = target;
+    return false;
+}
+
+bool handle_jalr(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    // cpu.v adds bits [31:1] of the base and offset
+    auto target = (simulator.registers[instruction.rs1] & ~1U) + (instruction.immediate & ~1U);
+    if(target & 2)
+        return simulator.trap(cause_instruction_address_misaligned, instruction.pc);
+    simulator.registers[instruction.rd] = instruction.pc + 4;
+    simulator.pc = target;
+    return false;
+}
+
+struct BranchEq
+{
+    static bool evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a == b;
+    }
+};
+
+struct BranchNe
+{
+    static bool evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a != b;
+    }
+};
+
+struct BranchLt
+{
+    static bool evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return static_cast<std::int32_t>(a) < static_cast<std::int32_t>(b);
+    }
+};
+
+struct BranchGe
+{
+    static bool evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return static_cast<std::int32_t>(a) >= static_cast<std::int32_t>(b);
+    }
+};
+
+struct BranchLtu
+{
+    static bool evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a < b;
+    }
+};
+
+struct BranchGeu
+{
+    static bool evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a >= b;
+    }
+};
+
+template <typename Condition>
+bool handle_branch(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    if(!Condition::evaluate(simulator.registers[instruction.rs1],
+                            simulator.registers[instruction.rs2]))
+    {
+        simulator.pc = instruction.pc + 4;
+        return false;
+    }
+    auto target = instruction.pc + instruction.immediate;
+    if(target & 2)
+        return simulator.trap(cause_instruction_address_misaligned, instruction.pc);
+    simulator.pc = target;
+    return false;
+}
+
+struct AluAdd
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a + b;
+    }
+};
+
+struct AluSub
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a - b;
+    }
+};
+
+struct AluSll
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a << (b & 0x1F);
+    }
+};
+
+struct AluSlt
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return static_cast<std::int32_t>(a) < static_cast<std::int32_t>(b);
+    }
+};
+
+struct AluSltu
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a < b;
+    }
+};
+
+struct AluXor
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a ^ b;
+    }
+};
+
+struct AluSrl
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a >> (b & 0x1F);
+    }
+};
+
+struct AluSra
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return static_cast<std::uint32_t>(static_cast<std::int32_t>(a) >> (b & 0x1F));
+    }
+};
+
+struct AluOr
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a | b;
+    }
+};
+
+struct AluAnd
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a & b;
+    }
+};
+
+struct AluXnor
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a ^ ~b;
+    }
+};
+
+struct AluOrn
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a | ~b;
+    }
+};
+
+struct AluAndn
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a & ~b;
+    }
+};
+
+struct AluMin
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return static_cast<std::int32_t>(a) < static_cast<std::int32_t>(b) ? a : b;
+    }
+};
+
+struct AluMinu
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a < b ? a : b;
+    }
+};
+
+struct AluMax
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return static_cast<std::int32_t>(a) < static_cast<std::int32_t>(b) ? b : a;
+    }
+};
+
+struct AluMaxu
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a < b ? b : a;
+    }
+};
+
+struct AluRol
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a << (b & 0x1F) | a >> (-b & 0x1F);
+    }
+};
+
+struct AluRor
+{
+    static std::uint32_t evaluate(std::uint32_t a, std::uint32_t b) noexcept
+    {
+        return a >> (b & 0x1F) | a << (-b & 0x1F);
+    }
+};
+
+struct AluClz
+{
+    static std::uint32_t evaluate(std::uint32_t a) noexcept
+    {
+        return a == 0 ? 32 : __builtin_clz(a);
+    }
+};
+
+struct AluCtz
+{
+    static std::uint32_t evaluate(std::uint32_t a) noexcept
+    {
+        return a == 0 ? 32 : __builtin_ctz(a);
+    }
+};
+
+struct AluCpop
+{
+    static std::uint32_t evaluate(std::uint32_t a) noexcept
+    {
+        return __builtin_popcount(a);
+    }
+};
+
+struct AluSextB
+{
+    static std::uint32_t evaluate(std::uint32_t a) noexcept
+    {
+        return sign_extend<std::uint32_t>(a, 8);
+    }
+};
+
+struct AluSextH
+{
+    static std::uint32_t evaluate(std::uint32_t a) noexcept
+    {
+        return sign_extend<std::uint32_t>(a, 16);
+    }
+};
+
+struct AluZextH
+{
+    static std::uint32_t evaluate(std::uint32_t a) noexcept
+    {
+        return a & 0xFFFF;
+    }
+};
+
+struct AluOrcB
+{
+    static std::uint32_t evaluate(std::uint32_t a) noexcept
+    {
+        std::uint32_t retval = 0;
+        for(unsigned i = 0; i < 32; i += 8)
+            if(a >> i & 0xFF)
+                retval |= 0xFFU << i;
+        return retval;
+    }
+};
+
+struct AluRev8
+{
+    static std::uint32_t evaluate(std::uint32_t a) noexcept
+    {
+        return a >> 24 | (a >> 8 & 0xFF00) | (a << 8 & 0xFF0000) | a << 24;
+    }
+};
+
+template <typename Operation>
+bool handle_op_imm(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    simulator.registers[instruction.rd] =
+        Operation::evaluate(simulator.registers[instruction.rs1], instruction.immediate);
+    return true;
+}
+
+template <typename Operation>
+bool handle_op(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    simulator.registers[instruction.rd] = Operation::evaluate(
+        simulator.registers[instruction.rs1], simulator.registers[instruction.rs2]);
+    return true;
+}
+
+template <typename Operation>
+bool handle_unary(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    simulator.registers[instruction.rd] = Operation::evaluate(simulator.registers[instruction.rs1]);
+    return true;
+}
+
+// loads and stores select bytes out of the addressed word the same way cpu.v does
+template <unsigned Size, bool IsSigned>
+bool handle_load(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    auto address = simulator.registers[instruction.rs1] + instruction.immediate;
+    if(address & (Size - 1))
+        return simulator.trap(cause_load_address_misaligned, instruction.pc);
+    std::uint32_t word;
+    if(Simulator::is_ram_address(address))
+        word = simulator.read_ram_u32(address & ~3U);
+    else if(!simulator.load_io(address, word))
+        return simulator.trap(cause_load_access_fault, instruction.pc);
+    word >>= 8 * (address & 3);
+    if(Size < 4)
+        word = IsSigned ? sign_extend<std::uint32_t>(word, 8 * Size) :
+                          word & ((1U << (8 * Size)) - 1);
+    simulator.registers[instruction.rd] = word;
+    return true;
+}
+
+template <unsigned Size>
+bool handle_store(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    auto address = simulator.registers[instruction.rs1] + instruction.immediate;
+    if(address & (Size - 1))
+        return simulator.trap(cause_store_amo_address_misaligned, instruction.pc);
+    auto value = simulator.registers[instruction.rs2];
+    if(!Simulator::is_ram_address(address))
+    {
+        auto byte_mask = ((1U << Size) - 1) << (address & 3);
+        if(!simulator.store_io(address, byte_mask, value << 8 * (address & 3)))
+            return simulator.trap(cause_store_amo_access_fault, instruction.pc);
+        if(simulator.running)
+            return true;
+        simulator.pc = instruction.pc + 4;
+        return false;
+    }
+    for(unsigned i = 0; i < Size; i++)
+        simulator.write_ram_byte(address + i, value >> 8 * i);
+    if(simulator.check_code_store(address))
+        return true;
+    simulator.pc = instruction.pc + 4;
+    return false;
+}
+
+bool handle_fence(Simulator &, const DecodedInstruction &)
+{
+    return true;
+}
+
+// matches fetch_action_fence: refetch everything after the fence.i
+bool handle_fence_i(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    simulator.flush_pending = true;
+    simulator.pc = instruction.pc + 4;
+    return false;
+}
+
+bool handle_ecall_ebreak(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    // same cause selection as handle_trap in cpu.v
+    return simulator.trap(instruction.immediate & 1 ? cause_machine_environment_call :
+                                                      cause_breakpoint,
+                          instruction.pc + 4);
+}
+
+bool handle_csr(Simulator &simulator, const DecodedInstruction &instruction)
+{
+    return simulator.csr(instruction);
+}
+
+bool Simulator::csr(const DecodedInstruction &instruction) noexcept
+{
+    auto csr_number = instruction.immediate & 0xFFF;
+    auto input_value =
+        instruction.funct3 & 4 ? instruction.rs1 : registers[instruction.rs1];
+    bool reads = (instruction.funct3 & 2) || instruction.rd != discard_register;
+    bool writes = !(instruction.funct3 & 2) || instruction.rs1 != 0;
+    auto evaluate = [&](std::uint32_t previous_value) -> std::uint32_t
+    {
+        switch(instruction.funct3 & 3)
+        {
+        case 1:
+            return input_value;
+        case 2:
+            return input_value | previous_value;
+        default:
+            return ~input_value & previous_value;
+        }
+    };
+    std::uint32_t output_value = 0;
+    switch(csr_number)
+    {
+    case csr_cycle:
+    case csr_cycleh:
+    {
+        if(writes)
+            return trap(cause_illegal_instruction, instruction.pc);
+        // a functional simulator has no timing: count one cycle per instruction
+        std::uint64_t cycle_counter =
+            instruction_count + (&instruction - current_block_instructions);
+        output_value = csr_number == csr_cycle ? cycle_counter : cycle_counter >> 32;
+        break;
+    }
+    case csr_time:
+    case csr_instret:
+    case csr_timeh:
+    case csr_instreth:
+    case csr_mvendorid:
+    case csr_marchid:
+    case csr_mimpid:
+    case csr_mhartid:
+        if(writes)
+            return trap(cause_illegal_instruction, instruction.pc);
+        // the counters don't count on the hardware either
+        output_value = 0;
+        break;
+    case csr_misa:
+        output_value = misa;
+        break;
+    case csr_mstatus:
+    {
+        output_value = 0x1800 | (mstatus_mpie ? 0x80 : 0) | (mstatus_mie ? 0x8 : 0);
+        auto written_value = evaluate(output_value);
+        if(writes)
+        {
+            mstatus_mpie = written_value & 0x80;
+            mstatus_mie = written_value & 0x8;
+        }
+        break;
+    }
+    case csr_mie:
+    {
+        output_value = (mie_meie ? 0x800 : 0) | (mie_mtie ? 0x80 : 0) | (mie_msie ? 0x8 : 0);
+        auto written_value = evaluate(output_value);
+        if(writes)
+        {
+            mie_meie = written_value & 0x800;
+            mie_mtie = written_value & 0x80;
+            mie_msie = written_value & 0x8;
+        }
+        break;
+    }
+    case csr_mtvec:
+        output_value = mtvec;
+        break;
+    case csr_mscratch:
+        output_value = mscratch;
+        if(writes)
+            mscratch = evaluate(output_value);
+        break;
+    case csr_mepc:
+        output_value = mepc;
+        if(writes)
+            mepc = evaluate(output_value);
+        break;
+    case csr_mcause:
+        output_value = mcause;
+        if(writes)
+            mcause = evaluate(output_value);
+        break;
+    case csr_mip:
+        output_value = 0;
+        break;
+    default:
+        return trap(cause_illegal_instruction, instruction.pc);
+    }
+    if(reads)
+        registers[instruction.rd] = output_value;
+    return true;
+}
+
+bool Simulator::load_io(std::uint32_t address, std::uint32_t &word) noexcept
+{
+    switch(address & ~3U)
+    {
+    case tty_location:
+        word = 0;
+        return true;
+    case gpio_location:
+        word = gpio_switches | gpio_output;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Simulator::store_io(std::uint32_t address,
+                         std::uint32_t byte_mask,
+                         std::uint32_t value) noexcept
+{
+    switch(address & ~3U)
+    {
+    case tty_location:
+        // sb, sh and sw to the TTY write 1, 2 or 4 characters, lowest address first
+        if(byte_mask != 0x1 && byte_mask != 0x3 && byte_mask != 0xF)
+            return false;
+        for(; byte_mask != 0; byte_mask >>= 1, value >>= 8)
+            write_tty(value);
+        return true;
+    case gpio_location:
+        if(byte_mask & 1)
+            gpio_output = value;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Simulator::write_tty(std::uint8_t ch)
+{
+    if(ch == 0x1B)
+    {
+        // main.cpp starts every frame with an escape sequence
+        frame_count++;
+        update_switches();
+        if(frame_limit != 0 && frame_count >= frame_limit)
+            running = false;
+    }
+    if(!tty_output)
+        return;
+    if(tty_utf8)
+    {
+        switch(ch)
+        {
+        case 0xB0:
+            std::fputs("░", tty_output);
+            return;
+        case 0xB1:
+            std::fputs("▒", tty_output);
+            return;
+        case 0xB2:
+            std::fputs("▓", tty_output);
+            return;
+        }
+    }
+    std::putc(ch, tty_output);
+}
+
+Block *Simulator::decode_block(std::uint32_t start_pc)
+{
+    std::unique_ptr<Block> block(new Block);
+    block->start_pc = start_pc;
+    block->ends_with_fallthrough = false;
+    std::uint32_t pc = start_pc;
+    while(true)
+    {
+        if(!is_ram_address(pc) || block->instructions.size() >= max_block_length)
+        {
+            DecodedInstruction fallthrough{};
+            fallthrough.handler = handle_fallthrough;
+            fallthrough.pc = pc;
+            block->instructions.push_back(fallthrough);
+            block->ends_with_fallthrough = true;
+            break;
+        }
+        word_is_code[(pc - ram_start) / 4] = true;
+        auto instruction = read_ram_u32(pc);
+        DecodedInstruction decoded{};
+        decoded.pc = pc;
+        auto opcode = instruction & 0x7F;
+        auto rd = (instruction >> 7) & 0x1F;
+        decoded.rd = rd == 0 ? discard_register : rd;
+        decoded.funct3 = (instruction >> 12) & 7;
+        decoded.rs1 = (instruction >> 15) & 0x1F;
+        decoded.rs2 = (instruction >> 20) & 0x1F;
+        auto funct7 = instruction >> 25;
+        auto i_immediate = sign_extend<std::uint32_t>(instruction >> 20, 12);
+        bool ends_block = false;
+        decoded.handler = handle_illegal_instruction;
+        switch(opcode)
+        {
+        case opcode_load:
+            decoded.immediate = i_immediate;
+            switch(decoded.funct3)
+            {
+            case 0:
+                decoded.handler = handle_load<1, true>;
+                break;
+            case 1:
+                decoded.handler = handle_load<2, true>;
+                break;
+            case 2:
+                decoded.handler = handle_load<4, false>;
+                break;
+            case 4:
+                decoded.handler = handle_load<1, false>;
+                break;
+            case 5:
+                decoded.handler = handle_load<2, false>;
+                break;
+            }
+            break;
+        case opcode_misc_mem:
+            decoded.immediate = i_immediate;
+            if(decoded.funct3 == 0 && (i_immediate & 0xF00) == 0 && decoded.rs1 == 0 && rd == 0)
+                decoded.handler = handle_fence;
+            else if(decoded.funct3 == 1 && (i_immediate & 0xFFF) == 0 && decoded.rs1 == 0
+                    && rd == 0)
+                decoded.handler = handle_fence_i;
+            break;
+        case opcode_op_imm:
+            decoded.immediate = i_immediate;
+            switch(decoded.funct3)
+            {
+            case 0:
+                decoded.handler = handle_op_imm<AluAdd>;
+                break;
+            case 1:
+                if(funct7 == 0)
+                    decoded.handler = handle_op_imm<AluSll>;
+                else if(funct7 == 0x30)
+                {
+                    switch(decoded.rs2)
+                    {
+                    case 0:
+                        decoded.handler = handle_unary<AluClz>;
+                        break;
+                    case 1:
+                        decoded.handler = handle_unary<AluCtz>;
+                        break;
+                    case 2:
+                        decoded.handler = handle_unary<AluCpop>;
+                        break;
+                    case 4:
+                        decoded.handler = handle_unary<AluSextB>;
+                        break;
+                    case 5:
+                        decoded.handler = handle_unary<AluSextH>;
+                        break;
+                    }
+                }
+                break;
+            case 2:
+                decoded.handler = handle_op_imm<AluSlt>;
+                break;
+            case 3:
+                decoded.handler = handle_op_imm<AluSltu>;
+                break;
+            case 4:
+                decoded.handler = handle_op_imm<AluXor>;
+                break;
+            case 5:
+                if(funct7 == 0)
+                    decoded.handler = handle_op_imm<AluSrl>;
+                else if(funct7 == 0x20)
+                    decoded.handler = handle_op_imm<AluSra>;
+                else if(funct7 == 0x30)
+                    decoded.handler = handle_op_imm<AluRor>;
+                else if((i_immediate & 0xFFF) == 0x287)
+                    decoded.handler = handle_unary<AluOrcB>;
+                else if((i_immediate & 0xFFF) == 0x698)
+                    decoded.handler = handle_unary<AluRev8>;
+                break;
+            case 6:
+                decoded.handler = handle_op_imm<AluOr>;
+                break;
+            case 7:
+                decoded.handler = handle_op_imm<AluAnd>;
+                break;
+            }
+            break;
+        case opcode_op:
+            switch(decoded.funct3 | funct7 << 3)
+            {
+            case 0:
+                decoded.handler = handle_op<AluAdd>;
+                break;
+            case 0 | 0x20 << 3:
+                decoded.handler = handle_op<AluSub>;
+                break;
+            case 1:
+                decoded.handler = handle_op<AluSll>;
+                break;
+            case 1 | 0x30 << 3:
+                decoded.handler = handle_op<AluRol>;
+                break;
+            case 2:
+                decoded.handler = handle_op<AluSlt>;
+                break;
+            case 3:
+                decoded.handler = handle_op<AluSltu>;
+                break;
+            case 4:
+                decoded.handler = handle_op<AluXor>;
+                break;
+            case 4 | 0x20 << 3:
+                decoded.handler = handle_op<AluXnor>;
+                break;
+            case 4 | 0x05 << 3:
+                decoded.handler = handle_op<AluMin>;
+                break;
+            case 4 | 0x04 << 3:
+                if(decoded.rs2 == 0)
+                    decoded.handler = handle_unary<AluZextH>;
+                break;
+            case 5:
+                decoded.handler = handle_op<AluSrl>;
+                break;
+            case 5 | 0x20 << 3:
+                decoded.handler = handle_op<AluSra>;
+                break;
+            case 5 | 0x30 << 3:
+                decoded.handler = handle_op<AluRor>;
+                break;
+            case 5 | 0x05 << 3:
+                decoded.handler = handle_op<AluMinu>;
+                break;
+            case 6:
+                decoded.handler = handle_op<AluOr>;
+                break;
+            case 6 | 0x20 << 3:
+                decoded.handler = handle_op<AluOrn>;
+                break;
+            case 6 | 0x05 << 3:
+                decoded.handler = handle_op<AluMax>;
+                break;
+            case 7:
+                decoded.handler = handle_op<AluAnd>;
+                break;
+            case 7 | 0x20 << 3:
+                decoded.handler = handle_op<AluAndn>;
+                break;
+            case 7 | 0x05 << 3:
+                decoded.handler = handle_op<AluMaxu>;
+                break;
+            }
+            break;
+        case opcode_lui:
+            decoded.immediate = instruction & 0xFFFFF000U;
+            decoded.handler = handle_lui;
+            break;
+        case opcode_auipc:
+            decoded.immediate = instruction & 0xFFFFF000U;
+            decoded.handler = handle_auipc;
+            break;
+        case opcode_store:
+            decoded.immediate = sign_extend<std::uint32_t>(
+                (instruction >> 20 & ~0x1FU) | (instruction >> 7 & 0x1F), 12);
+            switch(decoded.funct3)
+            {
+            case 0:
+                decoded.handler = handle_store<1>;
+                break;
+            case 1:
+                decoded.handler = handle_store<2>;
+                break;
+            case 2:
+                decoded.handler = handle_store<4>;
+                break;
+            }
+            break;
+        case opcode_branch:
+            decoded.immediate =
+                sign_extend<std::uint32_t>((instruction >> 19 & 0x1000) | (instruction << 4 & 0x800)
+                                               | (instruction >> 20 & 0x7E0)
+                                               | (instruction >> 7 & 0x1E),
+                                           13);
+            ends_block = true;
+            switch(decoded.funct3)
+            {
+            case 0:
+                decoded.handler = handle_branch<BranchEq>;
+                break;
+            case 1:
+                decoded.handler = handle_branch<BranchNe>;
+                break;
+            case 4:
+                decoded.handler = handle_branch<BranchLt>;
+                break;
+            case 5:
+                decoded.handler = handle_branch<BranchGe>;
+                break;
+            case 6:
+                decoded.handler = handle_branch<BranchLtu>;
+                break;
+            case 7:
+                decoded.handler = handle_branch<BranchGeu>;
+                break;
+            }
+            break;
+        case opcode_jalr:
+            decoded.immediate = i_immediate;
+            ends_block = true;
+            if(decoded.funct3 == 0)
+                decoded.handler = handle_jalr;
+            break;
+        case opcode_jal:
+            decoded.immediate =
+                sign_extend<std::uint32_t>((instruction >> 11 & 0x100000) | (instruction & 0xFF000)
+                                               | (instruction >> 9 & 0x800)
+                                               | (instruction >> 20 & 0x7FE),
+                                           21);
+            ends_block = true;
+            decoded.handler = handle_jal;
+            break;
+        case opcode_system:
+            decoded.immediate = i_immediate;
+            if(decoded.funct3 == 0)
+            {
+                if(decoded.rs1 == 0 && rd == 0 && (i_immediate & ~1U) == 0)
+                    decoded.handler = handle_ecall_ebreak;
+            }
+            else if(decoded.funct3 != 4)
+            {
+                decoded.handler = handle_csr;
+            }
+            break;
+        }
+        if(decoded.handler == handle_illegal_instruction || decoded.handler == handle_fence_i
+           || decoded.handler == handle_ecall_ebreak)
+            ends_block = true;
+        block->instructions.push_back(decoded);
+        pc += 4;
+        if(ends_block)
+            break;
+    }
+    block->end_pc = pc;
+    blocks_decoded++;
+    auto retval = block.get();
+    block_table[(start_pc - ram_start) / 4] = retval;
+    blocks.push_back(std::move(block));
+    return retval;
+}
+
+void Simulator::run()
+{
+    update_switches();
+    while(running)
+    {
+        if(flush_pending)
+            flush_blocks();
+        if(!is_ram_address(pc))
+        {
+            // matches fetch_output_state_trap: mepc is the address that couldn't be fetched
+            trap(cause_instruction_access_fault, pc);
+            continue;
+        }
+        auto block = block_table[(pc - ram_start) / 4];
+        if(!block)
+            block = decode_block(pc);
+        auto instruction = block->instructions.data();
+        current_block_instructions = instruction;
+        while(instruction->handler(*this, *instruction))
+            instruction++;
+        instruction_count += instruction - block->instructions.data() + 1;
+        if(block->ends_with_fallthrough && instruction == &block->instructions.back())
+            instruction_count--;
+    }
+}
+
+bool Simulator::load_elf(const std::string &file_name)
+{
+    std::ifstream is(file_name, std::ios::binary);
+    std::vector<std::uint8_t> file((std::istreambuf_iterator<char>(is)),
+                                   std::istreambuf_iterator<char>());
+    if(!is)
+    {
+        std::cerr << "can't read " << file_name << std::endl;
+        return false;
+    }
+    auto read_u16 = [&](std::size_t offset) -> std::uint32_t
+    {
+        return file[offset] | file[offset + 1] << 8;
+    };
+    auto read_u32 = [&](std::size_t offset) -> std::uint32_t
+    {
+        return read_u16(offset) | read_u16(offset + 2) << 16;
+    };
+    constexpr std::size_t elf_header_size = 52;
+    constexpr std::uint32_t em_riscv = 243;
+    constexpr std::uint32_t pt_load = 1;
+    if(file.size() < elf_header_size || std::memcmp(file.data(), "\x7F" "ELF", 4) != 0
+       || file[4] != 1 || file[5] != 1 || read_u16(18) != em_riscv)
+    {
+        std::cerr << file_name << " is not a 32-bit little-endian RISC-V ELF file" << std::endl;
+        return false;
+    }
+    auto program_header_offset = read_u32(28);
+    auto program_header_size = read_u16(42);
+    auto program_header_count = read_u16(44);
+    for(std::size_t i = 0; i < program_header_count; i++)
+    {
+        std::size_t header = program_header_offset + i * program_header_size;
+        if(header + 32 > file.size())
+        {
+            std::cerr << file_name << ": truncated program header" << std::endl;
+            return false;
+        }
+        if(read_u32(header) != pt_load)
+            continue;
+        auto offset = read_u32(header + 4);
+        auto address = read_u32(header + 12);
+        auto file_size = read_u32(header + 16);
+        auto memory_size = read_u32(header + 20);
+        if(memory_size == 0)
+            continue;
+        if(file_size > memory_size || offset + file_size > file.size()
+           || !is_ram_address(address) || memory_size > ram_start + ram_size - address)
+        {
+            std::cerr << file_name << ": segment at 0x" << std::hex << address << std::dec
+                      << " doesn't fit in RAM" << std::endl;
+            return false;
+        }
+        std::memcpy(&ram[address - ram_start], &file[offset], file_size);
+        std::memset(&ram[address - ram_start + file_size], 0, memory_size - file_size);
+    }
+    return true;
+}
+
+bool load_input_script(const std::string &file_name, std::vector<InputScriptEntry> &input_script)
+{
+    std::ifstream is(file_name);
+    if(!is)
+    {
+        std::cerr << "can't open " << file_name << std::endl;
+        return false;
+    }
+    std::string line;
+    for(std::size_t line_number = 1; std::getline(is, line); line_number++)
+    {
+        auto comment = line.find('#');
+        if(comment != std::string::npos)
+            line.erase(comment);
+        std::istringstream ss(line);
+        InputScriptEntry entry{};
+        if(!(ss >> entry.frame))
+        {
+            ss.clear();
+            std::string rest;
+            if(ss >> rest)
+            {
+                std::cerr << file_name << ":" << line_number << ": expected frame number"
+                          << std::endl;
+                return false;
+            }
+            continue;
+        }
+        std::string name;
+        while(ss >> name)
+        {
+            if(name == "sw2")
+                entry.switches |= switch_2_mask;
+            else if(name == "sw3")
+                entry.switches |= switch_3_mask;
+            else
+            {
+                std::cerr << file_name << ":" << line_number << ": unknown switch: " << name
+                          << std::endl;
+                return false;
+            }
+        }
+        if(!input_script.empty() && input_script.back().frame > entry.frame)
+        {
+            std::cerr << file_name << ":" << line_number << ": frames must be in order"
+                      << std::endl;
+            return false;
+        }
+        input_script.push_back(entry);
+    }
+    return true;
+}
+
+void help(const char *program_name)
+{
+    std::cerr << "usage: " << program_name << " [options] ram.elf\n"
+              << "options:\n"
+              << "  --frames <n>          stop after <n> frames have been started\n"
+              << "  --script <file>       switch input script: each line is a frame number\n"
+              << "                        followed by the switches (sw2, sw3) held down from\n"
+              << "                        that frame on\n"
+              << "  --tty <file>          write TTY output to <file> (default: stdout)\n"
+              << "  --no-tty              discard TTY output\n"
+              << "  --utf8                translate the block characters to UTF-8\n"
+              << "  --help                show this help" << std::endl;
+}
+}
+
+int main(int argc, char **argv)
+{
+    std::unique_ptr<Simulator> simulator(new Simulator);
+    std::string elf_file_name;
+    std::FILE *tty_file = nullptr;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if(arg == "--help" || arg == "-h")
+        {
+            help(argv[0]);
+            return 0;
+        }
+        else if(arg == "--utf8")
+            simulator->tty_utf8 = true;
+        else if(arg == "--no-tty")
+            simulator->tty_output = nullptr;
+        else if((arg == "--frames" || arg == "--script" || arg == "--tty") && i + 1 < argc)
+        {
+            std::string value = argv[++i];
+            if(arg == "--frames")
+                simulator->frame_limit = std::strtoull(value.c_str(), nullptr, 0);
+            else if(arg == "--script")
+            {
+                if(!load_input_script(value, simulator->input_script))
+                    return 1;
+            }
+            else
+            {
+                tty_file = std::fopen(value.c_str(), "wb");
+                if(!tty_file)
+                {
+                    std::cerr << "can't open " << value << std::endl;
+                    return 1;
+                }
+                simulator->tty_output = tty_file;
+            }
+        }
+        else if(arg.empty() || arg[0] == '-' || !elf_file_name.empty())
+        {
+            help(argv[0]);
+            return 1;
+        }
+        else
+            elf_file_name = arg;
+    }
+    if(elf_file_name.empty())
+    {
+        help(argv[0]);
+        return 1;
+    }
+    if(!simulator->load_elf(elf_file_name))
+        return 1;
+    auto start_time = std::chrono::steady_clock::now();
+    simulator->run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    if(tty_file)
+        std::fclose(tty_file);
+    else if(simulator->tty_output)
+        std::fflush(simulator->tty_output);
+    if(simulator->halted)
+        std::cerr << "halted at pc 0x" << std::hex << simulator->pc << " (mcause 0x"
+                  << simulator->mcause << ", mepc 0x" << simulator->mepc << ")" << std::dec
+                  << "\n";
+    std::cerr << simulator->instruction_count << " instructions, " << simulator->frame_count
+              << " frames in " << elapsed.count() << " s ("
+              << simulator->instruction_count / elapsed.count() / 1e6 << " MIPS), "
+              << simulator->blocks_decoded << " blocks decoded, " << simulator->cache_flushes
+              << " cache flushes" << std::endl;
+    return 0;
+}